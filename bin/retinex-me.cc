@@ -25,6 +25,7 @@ struct Options
   std::string output;
   bool allSteps;
   unsigned verbosity;
+  unsigned tiles;
 };
 
 void
@@ -51,6 +52,11 @@ parseOptions (Options& options, int argc, char* argv[])
     ("verbosity,v",
      po::value<unsigned> (&options.verbosity)->default_value (0),
      "control the library verbosity")
+
+    ("tiles,t",
+     po::value<unsigned> (&options.tiles)->default_value (0),
+     "use local statistics computed on a NxN grid of tiles"
+     " (0 means global statistics)")
     ;
 
   po::variables_map vm;
@@ -90,7 +96,7 @@ int main (int argc, char* argv[])
       exit (1);
     }
 
-  libretinex::Retinex retinex (image, options.verbosity);
+  libretinex::Retinex retinex (image, options.verbosity, options.tiles);
   libretinex::image_t outputImage = image;
 
   for (int step = libretinex::Retinex::NOTHING;
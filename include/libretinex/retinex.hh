@@ -62,9 +62,40 @@ namespace libretinex
     /// \param image the input image (will not be modified).
     /// \param verbosity controls how much information will be displayed
     ///                  (0 means quiet).
-    explicit Retinex (const image_t& image, unsigned verbosity = 0);
+    /// \param tiles number of tiles per dimension used to compute the
+    ///              image statistics of the logarithmic compressions and
+    ///              of the normalization step (0 or 1 means that global
+    ///              statistics are used).
+    ///
+    /// When tiles is greater than one, the mean, minimum and maximum
+    /// values are computed on each tile of a tiles x tiles grid and
+    /// bilinearly interpolated for each pixel (similarly to CLAHE).
+    /// This improves the normalization of images with uneven lighting.
+    explicit Retinex (const image_t& image,
+		      unsigned verbosity = 0,
+		      unsigned tiles = 0);
+
+    /// \brief Instantiate the algorithm on an image filled by the caller.
+    ///
+    /// The input image has to be written through inputImage before
+    /// calling outputImage. This avoids copying the input image twice
+    /// when it is not available as an image_t (e.g. foreign buffers).
+    ///
+    /// \param height the input image height.
+    /// \param width the input image width.
+    /// \param verbosity see above.
+    /// \param tiles see above.
+    Retinex (coord_t height, coord_t width,
+	     unsigned verbosity = 0,
+	     unsigned tiles = 0);
     ~Retinex ();
 
+    /// \brief The input image, to be filled before processing.
+    ///
+    /// \warning This method must not be called once outputImage has
+    ///          applied a processing step.
+    image_t& inputImage ();
+
     /// \brief The output image.
     ///
     /// The first call to this method will trigger the image processing.
@@ -103,6 +134,9 @@ namespace libretinex
     /// \brief Verbosity level as set by the constructor.
     unsigned verbosity_;
 
+    /// \brief Number of tiles per dimension as set by the constructor.
+    unsigned tiles_;
+
     /// \brief Describe the last applied step.
     Steps step_;
 
@@ -113,6 +147,9 @@ namespace libretinex
     /// algorithm.
     image_t outputImage_;
 
+    /// \brief Display the image information (used in verbose mode).
+    void printImageInformation () const;
+
     /// \brief Compute the Gaussian function.
     double gaussian (coord_t x, coord_t y, double sigma) const;
 
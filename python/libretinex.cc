@@ -0,0 +1,602 @@
+// Copyright 2010 Thomas Moulard.
+//
+// This file is part of libretinex.
+// libretinex is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// libretinex is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// You should have received a copy of the GNU Lesser General Public License
+// along with libretinex.  If not, see <http://www.gnu.org/licenses/>.
+
+// Python bindings of the libretinex library.
+//
+// Images are read through the buffer protocol (no intermediate Python
+// object is created) and results are returned as NumPy arrays. The GIL
+// is released while images are processed so that several Python
+// threads can normalize images in parallel.
+//
+// Each input image is copied once, directly into the image processed
+// in place by Retinex.
+
+#include <Python.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <new>
+#include <string>
+
+#include <visp/vpImage.h>
+
+#include <libretinex/retinex.hh>
+
+namespace
+{
+  using libretinex::Retinex;
+  using libretinex::coord_t;
+  using libretinex::image_t;
+  using libretinex::value_t;
+
+  /// \brief Pixel types supported by the bindings.
+  enum PixelType
+    {
+      /// \brief Gray levels in [0, 255].
+      PIXEL_UINT8,
+      /// \brief Gray levels in [0, 1].
+      PIXEL_FLOAT32
+    };
+
+  /// \brief Python object wrapping a Retinex instance.
+  struct RetinexObject
+  {
+    PyObject_HEAD
+    /// \brief Wrapped processor (owned).
+    Retinex* retinex;
+    /// \brief Pixel type of the input image, used for the output.
+    PixelType type;
+    /// \brief Set while the GIL is released to reject concurrent calls.
+    bool busy;
+    /// \brief Set once the processing is complete.
+    ///
+    /// The processed image is never modified afterwards, it can
+    /// therefore be shared with Python without copying it.
+    bool done;
+  };
+
+  /// \brief Error caught from the library.
+  ///
+  /// Exceptions are recorded (possibly while the GIL is released) and
+  /// converted into Python exceptions later on.
+  struct Error
+  {
+    Error ()
+      : failed (false),
+	noMemory (false)
+    {
+    }
+
+    /// \brief Record the exception being handled.
+    ///
+    /// Must be called from a catch block.
+    void record ()
+    {
+      failed = true;
+      try
+	{
+	  throw;
+	}
+      catch (std::bad_alloc&)
+	{
+	  noMemory = true;
+	}
+      catch (std::exception& exception)
+	{
+	  message = exception.what ();
+	}
+      catch (...)
+	{
+	  message = "unknown error";
+	}
+    }
+
+    /// \brief Set the Python exception (the GIL must be held).
+    void raise () const
+    {
+      if (noMemory)
+	PyErr_NoMemory ();
+      else
+	PyErr_SetString (PyExc_RuntimeError, message.c_str ());
+    }
+
+    bool failed;
+    bool noMemory;
+    std::string message;
+  };
+
+  /// \brief Acquire a read-only strided view of an image buffer.
+  ///
+  /// \param object the object exporting the buffer
+  /// \param ndim expected number of dimensions
+  /// \param buffer the resulting view, to be released by the caller
+  /// \param type the pixel type deduced from the buffer format
+  ///
+  /// \return false and set a Python exception on failure
+  bool getImageBuffer (PyObject* object, int ndim,
+		       Py_buffer& buffer, PixelType& type)
+  {
+    if (PyObject_GetBuffer (object, &buffer,
+			    PyBUF_STRIDED_RO | PyBUF_FORMAT) < 0)
+      return false;
+
+    // Native byte order prefixes are harmless.
+    const char* format = buffer.format ? buffer.format : "B";
+    if (*format == '@' || *format == '=')
+      ++format;
+
+    if (!std::strcmp (format, "B") && buffer.itemsize == 1)
+      type = PIXEL_UINT8;
+    else if (!std::strcmp (format, "f") && buffer.itemsize == 4)
+      type = PIXEL_FLOAT32;
+    else
+      {
+	PyErr_Format (PyExc_TypeError,
+		      "unsupported pixel format '%s'"
+		      " (expected uint8 or float32)", buffer.format);
+	PyBuffer_Release (&buffer);
+	return false;
+      }
+
+    if (buffer.ndim != ndim)
+      {
+	PyErr_Format (PyExc_ValueError,
+		      "expected a %d-dimensional array, got %d dimension(s)",
+		      ndim, buffer.ndim);
+	PyBuffer_Release (&buffer);
+	return false;
+      }
+
+    // The pixel count must fit in coord_t, ViSP images use it for sizes.
+    const unsigned long long maxSize = std::numeric_limits<coord_t>::max ();
+    const unsigned long long height = buffer.shape[ndim - 2];
+    const unsigned long long width = buffer.shape[ndim - 1];
+    if (height > maxSize || width > maxSize || height * width > maxSize)
+      {
+	PyErr_SetString (PyExc_OverflowError, "image too large");
+	PyBuffer_Release (&buffer);
+	return false;
+      }
+    return true;
+  }
+
+  /// \brief Convert a [0, 1] intensity into a gray level.
+  value_t toGrayLevel (float value)
+  {
+    const float scaled = value * 255.f + .5f;
+    if (!(scaled > 0.f))
+      return 0;
+    return static_cast<value_t> (std::min (scaled, 255.f));
+  }
+
+  /// \brief Image size of a buffer (its two last dimensions).
+  void imageSize (const Py_buffer& buffer, coord_t& height, coord_t& width)
+  {
+    height = static_cast<coord_t> (buffer.shape[buffer.ndim - 2]);
+    width = static_cast<coord_t> (buffer.shape[buffer.ndim - 1]);
+  }
+
+  /// \brief Copy one image of a buffer into a ViSP image.
+  ///
+  /// The image must already have the buffer image size, offset selects
+  /// the image in a stack of images.
+  void bufferToImage (const Py_buffer& buffer, PixelType type,
+		      Py_ssize_t offset, image_t& image)
+  {
+    const int d = buffer.ndim;
+    coord_t height;
+    coord_t width;
+    imageSize (buffer, height, width);
+    const Py_ssize_t rowStride = buffer.strides[d - 2];
+    const Py_ssize_t colStride = buffer.strides[d - 1];
+    const char* data = static_cast<const char*> (buffer.buf) + offset;
+
+    for (coord_t i = 0; i < height; ++i)
+      for (coord_t j = 0; j < width; ++j)
+	{
+	  const char* pixel = data + i * rowStride + j * colStride;
+	  if (type == PIXEL_UINT8)
+	    image[i][j] = *reinterpret_cast<const value_t*> (pixel);
+	  else
+	    {
+	      float value;
+	      std::memcpy (&value, pixel, sizeof (float));
+	      image[i][j] = toGrayLevel (value);
+	    }
+	}
+  }
+
+  /// \brief Copy a ViSP image into a C-contiguous buffer.
+  void imageToBuffer (const image_t& image, PixelType type, char* data)
+  {
+    const unsigned size = image.getHeight () * image.getWidth ();
+    if (type == PIXEL_UINT8)
+      std::memcpy (data, image.bitmap, size);
+    else
+      {
+	float* output = reinterpret_cast<float*> (data);
+	for (unsigned k = 0; k < size; ++k)
+	  output[k] = image.bitmap[k] / 255.f;
+      }
+  }
+
+  /// \brief Check that a step value is a valid Retinex::Steps.
+  bool checkStep (int step)
+  {
+    if (step < Retinex::NOTHING || step > Retinex::DONE)
+      {
+	PyErr_Format (PyExc_ValueError, "invalid step %d", step);
+	return false;
+      }
+    return true;
+  }
+
+  /// \brief Check that an integer argument is not negative.
+  ///
+  /// Arguments are parsed as signed integers so that negative values
+  /// are rejected instead of silently wrapping around.
+  bool checkNonNegative (const char* name, int value)
+  {
+    if (value < 0)
+      {
+	PyErr_Format (PyExc_ValueError, "%s must be non-negative", name);
+	return false;
+      }
+    return true;
+  }
+
+  /// \brief Convert a method implementation into a PyCFunction.
+  ///
+  /// Methods taking keywords have a different signature, the cast goes
+  /// through a generic function pointer type as CPython expects.
+  template <typename F>
+  PyCFunction asCFunction (F function)
+  {
+    return reinterpret_cast<PyCFunction>
+      (reinterpret_cast<void (*) ()> (function));
+  }
+
+  // Retinex type.
+
+  PyObject*
+  Retinex_new (PyTypeObject* type, PyObject*, PyObject*)
+  {
+    RetinexObject* self =
+      reinterpret_cast<RetinexObject*> (type->tp_alloc (type, 0));
+    if (self)
+      {
+	self->retinex = 0;
+	self->type = PIXEL_UINT8;
+	self->busy = false;
+	self->done = false;
+      }
+    return reinterpret_cast<PyObject*> (self);
+  }
+
+  int
+  Retinex_init (RetinexObject* self, PyObject* args, PyObject* kwds)
+  {
+    static const char* keywords[] = {"image", "verbosity", "tiles", 0};
+
+    PyObject* object = 0;
+    int verbosity = 0;
+    int tiles = 0;
+
+    if (!PyArg_ParseTupleAndKeywords
+	(args, kwds, "O|ii", const_cast<char**> (keywords),
+	 &object, &verbosity, &tiles))
+      return -1;
+    if (!checkNonNegative ("verbosity", verbosity)
+	|| !checkNonNegative ("tiles", tiles))
+      return -1;
+
+    // Arrays returned by output_image may still reference the
+    // processed image, the object can therefore not be re-initialized.
+    if (self->retinex)
+      {
+	PyErr_SetString (PyExc_RuntimeError,
+			 "Retinex object already initialized");
+	return -1;
+      }
+
+    Py_buffer buffer;
+    PixelType type;
+    if (!getImageBuffer (object, 2, buffer, type))
+      return -1;
+
+    Error error;
+    try
+      {
+	coord_t height;
+	coord_t width;
+	imageSize (buffer, height, width);
+	self->retinex = new Retinex (height, width, verbosity, tiles);
+	bufferToImage (buffer, type, 0, self->retinex->inputImage ());
+      }
+    catch (...)
+      {
+	error.record ();
+      }
+    PyBuffer_Release (&buffer);
+
+    if (error.failed)
+      {
+	error.raise ();
+	return -1;
+      }
+
+    self->type = type;
+    return 0;
+  }
+
+  void
+  Retinex_dealloc (RetinexObject* self)
+  {
+    // Instances of heap types own a reference to their type.
+    PyTypeObject* type = Py_TYPE (self);
+    delete self->retinex;
+    type->tp_free (reinterpret_cast<PyObject*> (self));
+    Py_DECREF (type);
+  }
+
+  PyObject*
+  Retinex_outputImage (RetinexObject* self, PyObject* args, PyObject* kwds)
+  {
+    static const char* keywords[] = {"stop_after", 0};
+
+    int step = Retinex::DONE;
+    if (!PyArg_ParseTupleAndKeywords
+	(args, kwds, "|i", const_cast<char**> (keywords), &step))
+      return 0;
+    if (!checkStep (step))
+      return 0;
+
+    if (!self->retinex)
+      {
+	PyErr_SetString (PyExc_RuntimeError, "Retinex object not initialized");
+	return 0;
+      }
+    if (self->busy)
+      {
+	PyErr_SetString (PyExc_RuntimeError, "Retinex object is in use");
+	return 0;
+      }
+
+    const image_t* image = 0;
+    Error error;
+
+    self->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    try
+      {
+	image =
+	  &self->retinex->outputImage (static_cast<Retinex::Steps> (step));
+      }
+    catch (...)
+      {
+	error.record ();
+      }
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+
+    if (error.failed)
+      {
+	error.raise ();
+	return 0;
+      }
+    if (step == Retinex::DONE)
+      self->done = true;
+
+    npy_intp dims[2] = {image->getHeight (), image->getWidth ()};
+
+    // Intermediate images are modified in place by further calls
+    // (possibly while another thread reads them): they are copied.
+    if (self->type == PIXEL_FLOAT32 || !self->done)
+      {
+	PyObject* array =
+	  PyArray_SimpleNew (2, dims, self->type == PIXEL_UINT8
+			     ? NPY_UINT8 : NPY_FLOAT32);
+	if (array)
+	  imageToBuffer (*image, self->type,
+			 PyArray_BYTES (reinterpret_cast<PyArrayObject*>
+					(array)));
+	return array;
+      }
+
+    // Expose the processed image without copying it. The array is
+    // read-only as the buffer belongs to the Retinex object which is
+    // kept alive through the array base.
+    PyObject* array =
+      PyArray_New (&PyArray_Type, 2, dims, NPY_UINT8, 0,
+		   image->bitmap, 0, NPY_ARRAY_CARRAY_RO, 0);
+    if (!array)
+      return 0;
+
+    Py_INCREF (self);
+    if (PyArray_SetBaseObject (reinterpret_cast<PyArrayObject*> (array),
+			       reinterpret_cast<PyObject*> (self)) < 0)
+      {
+	Py_DECREF (array);
+	return 0;
+      }
+    return array;
+  }
+
+  PyMethodDef Retinex_methods[] =
+    {
+      {"output_image",
+       asCFunction (Retinex_outputImage),
+       METH_VARARGS | METH_KEYWORDS,
+       "output_image(stop_after=DONE)\n\n"
+       "Process the image and return the result.\n\n"
+       "The GIL is released during the processing. Once the processing\n"
+       "is complete, uint8 results are read-only views of the internal\n"
+       "image. Intermediate results and float32 results are copies."},
+      {0, 0, 0, 0}
+    };
+
+  PyType_Slot Retinex_slots[] =
+    {
+      {Py_tp_doc,
+       const_cast<char*>
+       ("Retinex(image, verbosity=0, tiles=0)\n\n"
+	"Normalize the illumination of a gray image (2D uint8 or float32\n"
+	"array). See libretinex::Retinex for the parameters meaning.")},
+      {Py_tp_new, reinterpret_cast<void*> (Retinex_new)},
+      {Py_tp_init, reinterpret_cast<void*> (Retinex_init)},
+      {Py_tp_dealloc, reinterpret_cast<void*> (Retinex_dealloc)},
+      {Py_tp_methods, Retinex_methods},
+      {0, 0}
+    };
+
+  PyType_Spec Retinex_spec =
+    {
+      "libretinex.Retinex",
+      sizeof (RetinexObject),
+      0,
+      Py_TPFLAGS_DEFAULT,
+      Retinex_slots
+    };
+
+  // Module functions.
+
+  PyObject*
+  processBatch (PyObject*, PyObject* args, PyObject* kwds)
+  {
+    static const char* keywords[] =
+      {"images", "verbosity", "tiles", "stop_after", 0};
+
+    PyObject* object = 0;
+    int verbosity = 0;
+    int tiles = 0;
+    int step = Retinex::DONE;
+
+    if (!PyArg_ParseTupleAndKeywords
+	(args, kwds, "O|iii", const_cast<char**> (keywords),
+	 &object, &verbosity, &tiles, &step))
+      return 0;
+    if (!checkNonNegative ("verbosity", verbosity)
+	|| !checkNonNegative ("tiles", tiles)
+	|| !checkStep (step))
+      return 0;
+
+    Py_buffer buffer;
+    PixelType type;
+    if (!getImageBuffer (object, 3, buffer, type))
+      return 0;
+
+    npy_intp dims[3] = {buffer.shape[0], buffer.shape[1], buffer.shape[2]};
+    PyObject* array =
+      PyArray_SimpleNew (3, dims,
+			 type == PIXEL_UINT8 ? NPY_UINT8 : NPY_FLOAT32);
+    if (!array)
+      {
+	PyBuffer_Release (&buffer);
+	return 0;
+      }
+
+    char* output = PyArray_BYTES (reinterpret_cast<PyArrayObject*> (array));
+    const Py_ssize_t outputStride =
+      PyArray_STRIDE (reinterpret_cast<PyArrayObject*> (array), 0);
+    Error error;
+
+    Py_BEGIN_ALLOW_THREADS
+    try
+      {
+	coord_t height;
+	coord_t width;
+	imageSize (buffer, height, width);
+	for (Py_ssize_t n = 0; n < buffer.shape[0]; ++n)
+	  {
+	    Retinex retinex (height, width, verbosity, tiles);
+	    bufferToImage (buffer, type, n * buffer.strides[0],
+			   retinex.inputImage ());
+	    imageToBuffer
+	      (retinex.outputImage (static_cast<Retinex::Steps> (step)),
+	       type, output + n * outputStride);
+	  }
+      }
+    catch (...)
+      {
+	error.record ();
+      }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release (&buffer);
+
+    if (error.failed)
+      {
+	Py_DECREF (array);
+	error.raise ();
+	return 0;
+      }
+    return array;
+  }
+
+  PyMethodDef module_methods[] =
+    {
+      {"process_batch",
+       asCFunction (processBatch),
+       METH_VARARGS | METH_KEYWORDS,
+       "process_batch(images, verbosity=0, tiles=0, stop_after=DONE)\n\n"
+       "Process a stack of images (N x H x W array) and return the\n"
+       "results as a new array of the same shape and type.\n"
+       "The GIL is released during the processing."},
+      {0, 0, 0, 0}
+    };
+
+  PyModuleDef module =
+    {
+      PyModuleDef_HEAD_INIT,
+      "libretinex",
+      "Python bindings of the libretinex library.\n\n"
+      "Images are uint8 (gray levels in [0, 255]) or float32 (gray\n"
+      "levels in [0, 1]) arrays exporting the buffer protocol.",
+      -1,
+      module_methods,
+      0, 0, 0, 0
+    };
+} // end of anonymous namespace.
+
+PyMODINIT_FUNC
+PyInit_libretinex ()
+{
+  import_array ();
+
+  PyObject* m = PyModule_Create (&module);
+  if (!m)
+    return 0;
+
+  PyObject* type = PyType_FromSpec (&Retinex_spec);
+  if (!type || PyModule_AddObject (m, "Retinex", type) < 0)
+    {
+      Py_XDECREF (type);
+      Py_DECREF (m);
+      return 0;
+    }
+
+  PyModule_AddIntConstant (m, "NOTHING", Retinex::NOTHING);
+  PyModule_AddIntConstant (m, "LA1", Retinex::LA1);
+  PyModule_AddIntConstant (m, "LA2", Retinex::LA2);
+  PyModule_AddIntConstant (m, "DOG", Retinex::DOG);
+  PyModule_AddIntConstant (m, "NORMALIZE", Retinex::NORMALIZE);
+  PyModule_AddIntConstant (m, "DONE", Retinex::DONE);
+  return m;
+}
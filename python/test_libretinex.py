@@ -0,0 +1,159 @@
+# Copyright (C) 2010 Thomas Moulard, LAAS-CNRS.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Smoke test of the libretinex Python bindings."""
+
+import unittest
+
+import numpy
+
+import libretinex
+
+
+def makeImage(height=40, width=60, seed=0):
+    rng = numpy.random.RandomState(seed)
+    return rng.randint(0, 256, (height, width)).astype(numpy.uint8)
+
+
+class RetinexTest(unittest.TestCase):
+    def test_uint8(self):
+        image = makeImage()
+        output = libretinex.Retinex(image).output_image()
+        self.assertEqual(output.dtype, numpy.uint8)
+        self.assertEqual(output.shape, image.shape)
+        self.assertFalse(output.flags.writeable)
+
+    def test_float32(self):
+        image = makeImage().astype(numpy.float32) / 255.
+        output = libretinex.Retinex(image).output_image()
+        self.assertEqual(output.dtype, numpy.float32)
+        self.assertEqual(output.shape, image.shape)
+        self.assertTrue((output >= 0.).all() and (output <= 1.).all())
+
+    def test_float32_matches_uint8(self):
+        image = makeImage()
+        expected = libretinex.Retinex(image).output_image()
+        output = libretinex.Retinex(
+            image.astype(numpy.float32) / 255.).output_image()
+        self.assertTrue(
+            (numpy.rint(output * 255.).astype(numpy.uint8) == expected).all())
+
+    def test_strided(self):
+        image = makeImage()[:, ::-1]
+        self.assertFalse(image.flags.c_contiguous)
+        expected = libretinex.Retinex(
+            numpy.ascontiguousarray(image)).output_image()
+        output = libretinex.Retinex(image).output_image()
+        self.assertTrue((output == expected).all())
+
+    def test_stop_after(self):
+        image = makeImage()
+        output = libretinex.Retinex(image).output_image(libretinex.NOTHING)
+        self.assertTrue((output == image).all())
+
+    def test_view_ownership(self):
+        image = makeImage()
+        retinex = libretinex.Retinex(image, tiles=4)
+        output = retinex.output_image()
+        self.assertTrue(output.base is retinex)
+
+        expected = output.copy()
+        del retinex
+        self.assertTrue((output == expected).all())
+
+    def test_intermediate_copy(self):
+        retinex = libretinex.Retinex(makeImage())
+        output = retinex.output_image(libretinex.NOTHING)
+        self.assertFalse(output.base is retinex)
+
+        expected = output.copy()
+        retinex.output_image()
+        self.assertTrue((output == expected).all())
+
+        # Once done, earlier steps return the final image.
+        final = retinex.output_image(libretinex.NOTHING)
+        self.assertTrue(final.base is retinex)
+
+    def test_single_tile_is_global(self):
+        image = makeImage()
+        expected = libretinex.Retinex(image, tiles=0).output_image()
+        output = libretinex.Retinex(image, tiles=1).output_image()
+        self.assertTrue((output == expected).all())
+
+    def test_tiled_differs_from_global(self):
+        # Uneven lighting: the left part of the image is darker.
+        ramp = numpy.linspace(.1, 1., 60).astype(numpy.float32)
+        image = (makeImage() * ramp).astype(numpy.uint8)
+        expected = libretinex.Retinex(image).output_image()
+        output = libretinex.Retinex(image, tiles=4).output_image()
+        self.assertFalse((output == expected).all())
+
+    def test_flat_image(self):
+        # A flat image has a null range: the normalization produces zero
+        # which the post-processing turns into Th (5). The image is
+        # smaller than the filters so that it is still flat when it
+        # reaches the normalization step.
+        image = numpy.empty((4, 4), numpy.uint8)
+        image.fill(128)
+        for tiles in (0, 2):
+            output = libretinex.Retinex(image, tiles=tiles).output_image()
+            self.assertTrue((output == 5).all())
+
+    def test_batch(self):
+        images = numpy.stack([makeImage(seed=n) for n in range(3)])
+        for dtype, scale in ((numpy.uint8, 1), (numpy.float32, 255.)):
+            stack = (images / scale).astype(dtype)
+            outputs = libretinex.process_batch(stack, tiles=2)
+            self.assertEqual(outputs.dtype, dtype)
+            self.assertEqual(outputs.shape, stack.shape)
+            for n in range(len(stack)):
+                expected = libretinex.Retinex(
+                    stack[n], tiles=2).output_image()
+                self.assertTrue((outputs[n] == expected).all())
+
+    def test_invalid_dtype(self):
+        for dtype in (numpy.int32, numpy.float64):
+            self.assertRaises(TypeError, libretinex.Retinex,
+                              numpy.zeros((4, 4), dtype))
+        self.assertRaises(TypeError, libretinex.process_batch,
+                          numpy.zeros((2, 4, 4), numpy.int32))
+
+    def test_invalid_ndim(self):
+        self.assertRaises(ValueError, libretinex.Retinex,
+                          numpy.zeros(4, numpy.uint8))
+        self.assertRaises(ValueError, libretinex.process_batch,
+                          numpy.zeros((4, 4), numpy.uint8))
+
+    def test_invalid_stop_after(self):
+        retinex = libretinex.Retinex(makeImage())
+        for step in (libretinex.NOTHING - 1, libretinex.DONE + 1):
+            self.assertRaises(ValueError, retinex.output_image, step)
+            self.assertRaises(ValueError, libretinex.process_batch,
+                              numpy.zeros((1, 4, 4), numpy.uint8),
+                              stop_after=step)
+
+    def test_invalid_parameters(self):
+        image = makeImage()
+        for name in ('verbosity', 'tiles'):
+            self.assertRaises(ValueError, libretinex.Retinex,
+                              image, **{name: -1})
+            self.assertRaises(OverflowError, libretinex.Retinex,
+                              image, **{name: 2 ** 40})
+            self.assertRaises(ValueError, libretinex.process_batch,
+                              image[numpy.newaxis], **{name: -1})
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -13,9 +13,11 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with libretinex.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <limits>
+#include <vector>
 #include <boost/format.hpp>
 #include <boost/numeric/conversion/converter.hpp>
 #include <visp/vpImageFilter.h>
@@ -39,42 +41,201 @@ namespace libretinex
 
   namespace
   {
-    /// \brief Compute the image mean value.
-    double imageMean (const image_t& image)
+    /// \brief Mean, minimum and maximum values of an image.
+    ///
+    /// Statistics are computed on each tile of a regular grid and
+    /// bilinearly interpolated between the tiles centers. A grid of one
+    /// tile is equivalent to global image statistics.
+    ///
+    /// The statistics of a tile do not depend on the other tiles: the
+    /// tiles could be reduced in parallel (they currently are not).
+    class ImageStatistics
     {
-      if (!image.getHeight () || !image.getWidth ())
-	return 0.;
-
-      double sum = 0.;
-      for (coord_t i = 0; i < image.getHeight (); ++i)
-	for (coord_t j = 0; j < image.getWidth (); ++j)
-	  sum += image (i, j);
-      return sum / (image.getWidth () * image.getHeight ());
-    }
+    public:
+      ImageStatistics (const image_t& image, unsigned tiles)
+	: height_ (image.getHeight ()),
+	  width_ (image.getWidth ()),
+	  tilesH_ (std::max (1u, std::min (tiles, height_))),
+	  tilesW_ (std::max (1u, std::min (tiles, width_))),
+	  mean_ (tilesH_ * tilesW_, 0.),
+	  min_ (tilesH_ * tilesW_, std::numeric_limits<value_t>::max ()),
+	  max_ (tilesH_ * tilesW_, 0.)
+      {
+	if (!height_ || !width_)
+	  {
+	    std::fill (min_.begin (), min_.end (), 0.);
+	    return;
+	  }
+
+	for (coord_t ti = 0; ti < tilesH_; ++ti)
+	  for (coord_t tj = 0; tj < tilesW_; ++tj)
+	    {
+	      const coord_t iBegin = tileBound (ti, height_, tilesH_);
+	      const coord_t iEnd = tileBound (ti + 1, height_, tilesH_);
+	      const coord_t jBegin = tileBound (tj, width_, tilesW_);
+	      const coord_t jEnd = tileBound (tj + 1, width_, tilesW_);
+	      const unsigned idx = ti * tilesW_ + tj;
+
+	      double sum = 0.;
+	      value_t min = std::numeric_limits<value_t>::max ();
+	      value_t max = 0;
+	      for (coord_t i = iBegin; i < iEnd; ++i)
+		for (coord_t j = jBegin; j < jEnd; ++j)
+		  {
+		    sum += image (i, j);
+		    min = std::min (min, image (i, j));
+		    max = std::max (max, image (i, j));
+		  }
+
+	      mean_[idx] = sum / ((iEnd - iBegin) * (jEnd - jBegin));
+	      min_[idx] = min;
+	      max_[idx] = max;
+	    }
+
+	if (!isGlobal ())
+	  {
+	    computeWeights (height_, tilesH_, tilesW_, rows_);
+	    computeWeights (width_, tilesW_, 1, cols_);
+	  }
+      }
 
-    /// \brief Compute the image maximum value.
-    value_t imageMax (const image_t& image)
-    {
-      value_t res = 0;
-      for (coord_t i = 0; i < image.getHeight (); ++i)
-	for (coord_t j = 0; j < image.getWidth (); ++j)
-	  res = std::max (res, image (i, j));
-      return res;
-    }
+      /// \brief Statistics interpolated at one pixel.
+      struct Sample
+      {
+	double mean;
+	double min;
+	double max;
+      };
+
+      bool isGlobal () const
+      {
+	return tilesH_ == 1 && tilesW_ == 1;
+      }
 
-    /// \brief Compute the image minimum value.
-    value_t imageMin (const image_t& image)
+      unsigned tilesHeight () const
+      {
+	return tilesH_;
+      }
+
+      unsigned tilesWidth () const
+      {
+	return tilesW_;
+      }
+
+      /// \brief Interpolate the statistics at a given pixel.
+      void sample (coord_t i, coord_t j, Sample& res) const
+      {
+	if (isGlobal ())
+	  {
+	    res.mean = mean_[0];
+	    res.min = min_[0];
+	    res.max = max_[0];
+	    return;
+	  }
+
+	const Weight& row = rows_[i];
+	const Weight& col = cols_[j];
+
+	const unsigned k00 = row.t0 + col.t0;
+	const unsigned k01 = row.t0 + col.t1;
+	const unsigned k10 = row.t1 + col.t0;
+	const unsigned k11 = row.t1 + col.t1;
+
+	const double w00 = (1. - row.alpha) * (1. - col.alpha);
+	const double w01 = (1. - row.alpha) * col.alpha;
+	const double w10 = row.alpha * (1. - col.alpha);
+	const double w11 = row.alpha * col.alpha;
+
+	res.mean = w00 * mean_[k00] + w01 * mean_[k01]
+	  + w10 * mean_[k10] + w11 * mean_[k11];
+	res.min = w00 * min_[k00] + w01 * min_[k01]
+	  + w10 * min_[k10] + w11 * min_[k11];
+	res.max = w00 * max_[k00] + w01 * max_[k01]
+	  + w10 * max_[k10] + w11 * max_[k11];
+      }
+
+    private:
+      /// \brief Interpolation weights of a pixel coordinate.
+      ///
+      /// t0 and t1 are the offsets of the two nearest tiles in the grid
+      /// along this dimension, alpha is the weight of the second one.
+      struct Weight
+      {
+	unsigned t0;
+	unsigned t1;
+	double alpha;
+      };
+
+      /// \brief First coordinate of a tile along one dimension.
+      ///
+      /// The product is computed on 64 bits as t * size may overflow
+      /// coord_t for large images split into many tiles.
+      static coord_t tileBound (coord_t t, unsigned size, unsigned tiles)
+      {
+	const unsigned long long bound =
+	  static_cast<unsigned long long> (t) * size / tiles;
+	return static_cast<coord_t> (bound);
+      }
+
+      /// \brief Compute the weights of all the coordinates of a dimension.
+      ///
+      /// \param size image size along this dimension
+      /// \param tiles number of tiles along this dimension
+      /// \param step offset between two consecutive tiles in the grid
+      /// \param weights the resulting weights (one per coordinate)
+      static void computeWeights (unsigned size, unsigned tiles,
+				  unsigned step, std::vector<Weight>& weights)
+      {
+	weights.resize (size);
+	for (coord_t x = 0; x < size; ++x)
+	  {
+	    double pos = (x + .5) * tiles / size - .5;
+	    pos = std::max (0., std::min (pos, tiles - 1.));
+
+	    const coord_t t0 = static_cast<coord_t> (pos);
+	    const coord_t t1 = std::min (t0 + 1, tiles - 1);
+	    weights[x].t0 = t0 * step;
+	    weights[x].t1 = t1 * step;
+	    weights[x].alpha = pos - t0;
+	  }
+      }
+
+      unsigned height_;
+      unsigned width_;
+      unsigned tilesH_;
+      unsigned tilesW_;
+      std::vector<double> mean_;
+      std::vector<double> min_;
+      std::vector<double> max_;
+      /// \brief Interpolation weights of each row (unused if global).
+      std::vector<Weight> rows_;
+      /// \brief Interpolation weights of each column (unused if global).
+      std::vector<Weight> cols_;
+    };
+
+    /// \brief Display image statistics (used in verbose mode).
+    void printStatistics (const ImageStatistics& statistics)
     {
-      value_t res = std::numeric_limits<value_t>::max ();
-      for (coord_t i = 0; i < image.getHeight (); ++i)
-	for (coord_t j = 0; j < image.getWidth (); ++j)
-	  res = std::min (res, image (i, j));
-      return res;
+      if (statistics.isGlobal ())
+	{
+	  ImageStatistics::Sample sample;
+	  statistics.sample (0, 0, sample);
+	  std::cout << "\tMean = " << sample.mean << std::endl;
+	  std::cout << "\tMin = " << sample.min << std::endl;
+	  std::cout << "\tMax = " << sample.max << std::endl;
+	}
+      else
+	{
+	  boost::format fmt ("\tLocal statistics (%1%x%2% tiles)");
+	  fmt % statistics.tilesHeight () % statistics.tilesWidth ();
+	  std::cout << fmt.str () << std::endl;
+	}
     }
   } // end of anonymous namespace.
 
-  Retinex::Retinex (const image_t& image, unsigned verbosity)
+  Retinex::Retinex (const image_t& image, unsigned verbosity, unsigned tiles)
     : verbosity_ (verbosity),
+      tiles_ (tiles),
       step_ (NOTHING),
       outputImage_ (image)
   {
@@ -82,17 +243,35 @@ namespace libretinex
       std::cout << "Default constructor of Retinex." << std::endl;
 
     if (verbosity_ > 1)
-      {
-	std::cout << "\tImage information:" << std::endl;
-	std::cout << "\tWidth = " << outputImage_.getWidth () << std::endl;
-	std::cout << "\tHeight = " << outputImage_.getHeight () << std::endl;
-      }
+      printImageInformation ();
+  }
+
+  Retinex::Retinex (coord_t height, coord_t width,
+		    unsigned verbosity, unsigned tiles)
+    : verbosity_ (verbosity),
+      tiles_ (tiles),
+      step_ (NOTHING),
+      outputImage_ (height, width)
+  {
+    if (verbosity_ > 1)
+      std::cout << "Constructor of Retinex (image filled by the caller)."
+		<< std::endl;
+
+    if (verbosity_ > 1)
+      printImageInformation ();
   }
 
   Retinex::~Retinex ()
   {
   }
 
+  image_t&
+  Retinex::inputImage ()
+  {
+    assert (step_ == NOTHING && "input image already processed");
+    return this->outputImage_;
+  }
+
   const image_t&
   Retinex::outputImage (Steps stopAfter)
   {
@@ -125,6 +304,15 @@ namespace libretinex
     return this->outputImage_;
   }
 
+  void
+  Retinex::printImageInformation () const
+  {
+    std::cout << "\tImage information:" << std::endl;
+    std::cout << "\tWidth = " << outputImage_.getWidth () << std::endl;
+    std::cout << "\tHeight = " << outputImage_.getHeight () << std::endl;
+    std::cout << "\tTiles = " << tiles_ << std::endl;
+  }
+
   double
   Retinex::gaussian (coord_t x, coord_t y, double sigma) const
   {
@@ -227,14 +415,10 @@ namespace libretinex
 	std::cout << fmt.str () << std::endl;
       }
 
-    double mean = imageMean (outputImage_);
-    value_t max = imageMax (outputImage_);
+    const ImageStatistics statistics (outputImage_, tiles_);
 
     if (verbosity_ > 1)
-      {
-	std::cout << "\tMean = " << mean << std::endl;
-	std::cout << "\tMax = " << static_cast<int> (max) << std::endl;
-      }
+      printStatistics (statistics);
 
     vpImage<double> filteredImage;
     vpMatrix G_coeffs = buildGaussianCoeff (sigma);
@@ -246,6 +430,11 @@ namespace libretinex
     for (coord_t i = 0; i < outputImage_.getHeight (); ++i)
       for (coord_t j = 0; j < outputImage_.getWidth (); ++j)
 	{
+	  ImageStatistics::Sample sample;
+	  statistics.sample (i, j, sample);
+	  const double mean = sample.mean;
+	  const double max = sample.max;
+
 	  double F = filteredImage (i, j) + mean / 2.;
 
 	  if ((i < G_coeffs_h / 2)
@@ -310,24 +499,31 @@ namespace libretinex
     if (verbosity_ > 0)
       std::cout << "Apply normalization and post-processing." << std::endl;
 
-    double mean = imageMean (outputImage_);
-
-    // FIXME: is it really this?
-    const double sigma_i_bip =
-      std::fabs (imageMax (outputImage_) - imageMin (outputImage_));
+    const ImageStatistics statistics (outputImage_, tiles_);
 
     if (verbosity_ > 1)
       {
 	std::cout << "\tTh = " << Th << std::endl;
-	std::cout << "\tMean = " << mean << std::endl;
-	std::cout << "\tsigma_i_bip = " << sigma_i_bip << std::endl;
+	printStatistics (statistics);
       }
 
     for (coord_t i = 0; i < outputImage_.getHeight (); ++i)
       for (coord_t j = 0; j < outputImage_.getWidth (); ++j)
 	{
+	  ImageStatistics::Sample sample;
+	  statistics.sample (i, j, sample);
+	  const double mean = sample.mean;
+
+	  // FIXME: is it really this?
+	  const double sigma_i_bip = std::fabs (sample.max - sample.min);
+
 	  // Normalization
-	  double value = (outputImage_ (i, j) - mean) / sigma_i_bip;
+	  //
+	  // Flat regions (null range) are not normalized: the value is
+	  // set to zero, which the post-processing turns into Th.
+	  double value = 0.;
+	  if (sigma_i_bip > 0.)
+	    value = (outputImage_ (i, j) - mean) / sigma_i_bip;
 
 	  // Post-processing.
 	  if (value >= 0)